@@ -0,0 +1,121 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <vector>
+using namespace std;
+
+#include "index.h"
+
+// A B+-tree index answers EQ and range (LT, LTE, GTE, GT) lookups.  Its
+// entries are (key, RID) pairs kept in (key, RID) order, so duplicate
+// keys need no special handling, and separators in the inner nodes are
+// whole entries.  Keys are stored like those of a hash index: strings
+// cut at their first NUL and zero padded, then compared bytewise, and
+// numbers compared as their type.  Deletes only take the entry off its
+// leaf; nodes are never merged, and scans step over empty leaves.
+
+// the header page of an index file
+struct BTreeHdrPage
+{
+  int		offset;		// byte offset of the attribute in the record
+  int		length;		// its length, which is the key size
+  int		type;		// its Datatype
+  int		root;		// pageNo of the root node
+  int		height;		// levels of nodes, 1 if the root is a leaf
+  int		numEntries;	// entries in the index
+  int		firstLeaf;	// pageNo of the leftmost leaf
+};
+
+// A node holds numKeys entries if it is a leaf, and otherwise numKeys
+// separators between numKeys + 1 children: the pageNo of child 0, then
+// (separator i, child i + 1) pairs.  Child i + 1 holds the entries from
+// separator i on.
+const unsigned BTREENODEFIXED = 3 * sizeof(int);
+
+struct BTreeNodePage
+{
+  int		level;		// 0 for a leaf, the parent of level l is l + 1
+  int		numKeys;	// entries or separators on the node
+  int		next;		// leaf to the right, -1 for the last and inner nodes
+  char		data[PAGESIZE - BTREENODEFIXED];
+};
+
+// fraction of each node bulkLoad fills, leaving room for inserts
+const double BTREELOADFILL = 0.9;
+
+// create an empty B+-tree index file for the attribute
+const Status createBTreeIndex(const string & fileName, const int offset,
+                              const int length, const Datatype type);
+
+class BTreeIndex : public Index
+{
+public:
+
+  // open the index kept in fileName
+  BTreeIndex(const string & fileName, Status & status);
+
+  // end any scan and close the file
+  ~BTreeIndex();
+
+  const bool covers(const int offset, const int length, const Datatype type) const;
+  const bool handles(const Operator op) const;  // all but NE
+  const char* keyOf(const Record & rec) const;
+  const int getEntryCnt() const;
+  const Status insertEntry(const char* attr, const RID & rid);
+  // bulk loads the entries if the index is empty
+  const Status insertEntries(const char* const attrs[], const RID rids[], const int n);
+  const Status deleteEntry(const char* attr, const RID & rid);
+  const Status startScan(const char* attr, const Operator op);
+  const Status scanNext(RID & outRid);
+  const Status endScan();
+
+  // size of an entry, the key length + sizeof(RID)
+  const int getEntrySize() const;
+
+  // build the entry for value attr of the attribute in record rid
+  void makeEntry(const char* attr, const RID & rid, char* entry) const;
+
+  // compare entries a and b by key and then RID; < 0, 0 or > 0
+  const int compareEntries(const char* a, const char* b) const;
+
+  // build the tree of an empty index from the n entries of run, which
+  // must be in compareEntries order; BADINDEXPARM if the index is not
+  // empty or the run is out of order
+  const Status bulkLoad(const char* run, const int n);
+
+private:
+  File*		file;		// the index file
+  BTreeHdrPage*	hdr;		// its header page, pinned
+  int		hdrPageNo;
+  bool		hdrDirty;	// true if the header page has been updated
+  int		entrySize;	// key length + sizeof(RID)
+  int		leafCap;	// entries that fit on a leaf
+  int		innerCap;	// separators that fit on an inner node
+
+  vector<char>	scanKey;	// key of the scan
+  Operator	scanOp;		// and its operator
+  int		scanPageNo;	// leaf of the scan, -1 if none
+  Page*		scanPage;	// pinned while the scan is on it, or NULL
+  int		scanSlot;	// next entry of scanPage to look at
+
+  void makeKey(const char* attr, char* key) const;
+  const int compareKeys(const char* a, const char* b) const;
+  // entry i of a leaf, separator i of an inner node, and the pageNo of
+  // child i of an inner node, which may be unaligned
+  char* leafEntry(BTreeNodePage* node, const int i) const;
+  char* innerEntry(BTreeNodePage* node, const int i) const;
+  const int childOf(BTreeNodePage* node, const int i) const;
+  void setChild(BTreeNodePage* node, const int i, const int pageNo) const;
+  // descend to the leaf entry belongs on, listing the nodes on the way
+  // there, the leaf last, in path
+  const Status findLeaf(const char* entry, vector<int> & path);
+  // descend to the leftmost leaf that may hold a key k >= key (k > key
+  // if after)
+  const Status findLeafForKey(const char* key, const bool after, int & pageNo);
+  // add separator sep, followed by child, to the inner node path[depth],
+  // splitting it if full; depth -1 grows a new root
+  const Status insertInner(const vector<int> & path, const int depth,
+                           const char* sep, const int child);
+};
+
+#endif
@@ -1,6 +1,13 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "db.h"
 // define if debug output wanted
 //#define DEBUGBUF
@@ -8,24 +15,52 @@
 // declarations for buffer pool hash table
 struct hashBucket
 {
-	File*	file;    // pointer a file object (more on this below)
+	File*	file;    // pointer a file object (more on this below); NULL if empty
 	int	pageNo;  // page number within a file
 	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
 };
 
+// number of independently latched partitions of the buffer hash table
+const int NUMHASHLATCHES = 16;
 
-// hash table to keep track of pages in the buffer pool
+// one partition of the buffer hash table: an open addressed table with
+// linear probing and its own latch
+struct hashPartition
+{
+	std::mutex	latch;	// protects this partition
+	int		size;	// number of buckets, a power of two
+	int		count;	// number of entries in use
+	hashBucket*	ht;	// the buckets
+};
+
+
+// hash table to keep track of pages in the buffer pool.  The table is
+// split into NUMHASHLATCHES partitions so that threads working on
+// different pages rarely contend for a latch.  Each partition is open
+// addressed with linear probing and is allocated up front with room for
+// twice the number of frames, as many as could ever hash to it, so
+// inserts and removes never allocate and no partition gets more than
+// half full.
 class BufHashTbl
 {
 private:
-    int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    hashPartition parts[NUMHASHLATCHES];
+    unsigned long long hash(const File* file, const int pageNo) const;
+    hashPartition& partition(const unsigned long long h)
+    {
+	return parts[(h >> 40) & (NUMHASHLATCHES - 1)];
+    }
 
 public:
-    BufHashTbl(const int htSize);  // constructor
+    BufHashTbl(const int maxEntries);  // constructor
     ~BufHashTbl(); // destructor
+
+    // latch of the partition (file,pageNo) belongs to.  It must be held
+    // across insert, lookup and remove calls for that (file,pageNo).
+  std::mutex& latch(const File* file, const int pageNo)
+  {
+	return partition(hash(file, pageNo)).latch;
+  }
 	
     // insert entry into hash table mapping (file,pageNo) to frameNo;
     // returns 0 if OK, HASHTBLERROR if an error occurred
@@ -44,17 +79,70 @@ public:
 
 class BufMgr;  //forward declaration of BufMgr class 
 
-// class for maintaining information about buffer pool frames
+// class for maintaining information about buffer pool frames.
+//
+// A frame latch is a lock that, unlike std::mutex, may be released by a
+// thread other than the one that took it, as it is when an asynchronous
+// read into the frame completes on an I/O engine thread.
+class FrameLatch
+{
+private:
+  std::mutex              m;
+  std::condition_variable released;
+  bool                    held;
+
+public:
+  FrameLatch() : held(false) {}
+
+  void lock()
+    {
+      std::unique_lock<std::mutex> guard(m);
+      while (held) released.wait(guard);
+      held = true;
+    }
+
+  bool try_lock()
+    {
+      std::lock_guard<std::mutex> guard(m);
+      if (held) return false;
+      held = true;
+      return true;
+    }
+
+  void unlock()
+    {
+      {
+        std::lock_guard<std::mutex> guard(m);
+        held = false;
+      }
+      released.notify_one();
+    }
+};
+
+// A frame's latch is held by whoever is reading a page into it, writing
+// it back or evicting it.  file and pageNo change only while the frame
+// is latched and absent from the hash table.  pinCnt and dirty are
+// changed under the hash partition latch of the frame's page, which is
+// what lets an evicting thread be sure nobody pinned the page behind
+// its back.  Latch order is frame latch, then partition latch.  The
+// per-file list links are protected by BufMgr::fileLatch, which is
+// always taken last.
 class BufDesc {
     friend class BufMgr;
+    friend class BufPolicy;
 private:
   File* file;   // pointer to file object
   int   pageNo; // page within file
   int	frameNo;  // frame # of frame
-  int   pinCnt; // number of times this page has been pinned
-  bool 	dirty;	  // true if dirty;  false otherwise
-  bool 	valid;   // true if page is valid
-  bool  refbit;	 // has this buffer frame been reference recently
+  std::atomic<int>  pinCnt; // number of times this page has been pinned
+  std::atomic<bool> dirty;  // true if dirty;  false otherwise
+  std::atomic<bool> valid;  // true if page is valid (its contents are loaded)
+  std::atomic<bool> prefetched; // read ahead and not yet asked for
+  FrameLatch latch;         // held while the frame is loaded or written back
+
+  int   filePrev, fileNext;   // resident frames of the same file
+  int   dirtyPrev, dirtyNext; // frames of the same file that may be dirty
+  bool  onDirtyList;
 
   void Clear() {  // initialize buffer frame for a new user
     	pinCnt = 0;
@@ -62,6 +150,7 @@ private:
 	pageNo = -1;
     	dirty = false;
 	valid = false;
+	prefetched = false;
   };
 
   void Set(File* filePtr, int pageNum) { 
@@ -70,24 +159,175 @@ private:
       pinCnt = 1;
       dirty = false;
       valid = true;
-      refbit = true;
   }
 
   BufDesc() {
       Clear();
+      frameNo = -1;
+      filePrev = fileNext = dirtyPrev = dirtyNext = -1;
+      onDirtyList = false;
   }
 };
 
 
+// heads of the lists, threaded through BufDesc, of one file's frames
+struct FileFrames
+{
+  int firstFrame;   // resident frames, -1 if none
+  int firstDirty;   // frames that may be dirty, -1 if none
+  int numFrames;
+  int numDirty;
+
+  FileFrames() : firstFrame(-1), firstDirty(-1), numFrames(0), numDirty(0) {}
+};
+
+
+// Replacement policies.  A policy only ranks frames for eviction;
+// BufMgr still decides whether a candidate can actually be taken (it
+// must be unpinned and, once written back, still clean).  All methods
+// may be called from several threads at once.
+enum ReplPolicy { CLOCK, TWOQ };
+
+class BufPolicy
+{
+protected:
+  BufDesc* bufTable;
+  int      numBufs;
+
+  // what a policy may look at in a frame descriptor
+  bool pinned(const int frame) const { return bufTable[frame].pinCnt > 0; }
+  bool valid(const int frame) const { return bufTable[frame].valid; }
+
+public:
+  BufPolicy(BufDesc* table, const int bufs) : bufTable(table), numBufs(bufs) {}
+  virtual ~BufPolicy() {}
+
+  // make a policy of the given kind for a pool of bufs frames
+  static BufPolicy* create(const ReplPolicy policy, BufDesc* table, const int bufs);
+
+  // the page in frame was asked for again
+  virtual void touched(const int frame) = 0;
+  // (file, pageNo) was just placed in frame
+  virtual void loaded(const int frame, const File* file, const int pageNo) = 0;
+  // (file, pageNo) is being evicted from frame to make room
+  virtual void evicted(const int frame, const File* file, const int pageNo) = 0;
+  // frame was emptied without making room (page disposed or flushed)
+  virtual void freed(const int frame) = 0;
+  // store up to n frames to try to evict, best first; returns how many
+  // and sets scanned to the number of frames looked at to find them
+  virtual int candidates(int frames[], const int n, int & scanned) = 0;
+};
+
+// CLOCK: a hit sets the frame's reference bit, the sweep clears it.
+// This is the default and the policy BufMgr always had.
+class ClockPolicy : public BufPolicy
+{
+private:
+  std::atomic<unsigned int> clockHand;
+  std::atomic<bool>*        refbit;   // frame referenced since last sweep
+
+public:
+  ClockPolicy(BufDesc* table, const int bufs);
+  ~ClockPolicy();
+  void touched(const int frame);
+  void loaded(const int frame, const File* file, const int pageNo);
+  void evicted(const int frame, const File* file, const int pageNo);
+  void freed(const int frame);
+  int candidates(int frames[], const int n, int & scanned);
+};
+
+// key of a page remembered by TwoQPolicy after its eviction
+struct PageKey
+{
+  const File* file;
+  int pageNo;
+  bool operator == (const PageKey & other) const
+    { return file == other.file && pageNo == other.pageNo; }
+};
+
+struct PageKeyHash
+{
+  size_t operator () (const PageKey & key) const
+    { return (size_t)key.file ^ ((size_t)key.pageNo * 0x9e3779b97f4a7c15ULL); }
+};
+
+// 2Q (Johnson and Shasha).  Pages read in for the first time enter a
+// FIFO queue A1in; only pages asked for again after being evicted from
+// A1in, which are remembered in the ghost queue A1out, make it to the
+// LRU list Am.  A sequential scan thus only churns A1in and cannot push
+// out pages that are used repeatedly.
+class TwoQPolicy : public BufPolicy
+{
+private:
+  enum { FREE, A1IN, AM, NUMLISTS };
+
+  std::mutex latch;       // protects everything below
+  int*  list;             // list each frame is on
+  int*  prev;             // doubly linked lists threaded through frames
+  int*  next;
+  int   head[NUMLISTS];   // oldest frame of each list, -1 if empty
+  int   tail[NUMLISTS];   // newest frame of each list, -1 if empty
+  int   size[NUMLISTS];
+  int   kin;              // target size of A1in
+  unsigned kout;          // capacity of A1out
+
+  // A1out: ghosts in eviction order, each tagged with a sequence
+  // number, and the sequence number of every current ghost.  A ghost
+  // that is read in again simply leaves the map; its queue entry is
+  // stale and skipped when it reaches the front.
+  std::deque<std::pair<PageKey, unsigned long> > a1out;
+  std::unordered_map<PageKey, unsigned long, PageKeyHash> a1outMap;
+  unsigned long ghostSeq;
+
+  void unlink(const int frame);
+  void append(const int l, const int frame);
+  int  collect(const int l, int frames[], int found, const int n, int & scanned);
+
+public:
+  TwoQPolicy(BufDesc* table, const int bufs);
+  ~TwoQPolicy();
+  void touched(const int frame);
+  void loaded(const int frame, const File* file, const int pageNo);
+  void evicted(const int frame, const File* file, const int pageNo);
+  void freed(const int frame);
+  int candidates(int frames[], const int n, int & scanned);
+};
+
+
 struct BufStats
 {
-  int accesses;    // Total number of accesses to buffer pool
-  int diskreads;   // Number of pages read from disk (including allocs)
-  int diskwrites;  // Number of pages written back to disk
+  std::atomic<long long> accesses;    // Number of readPage calls
+  std::atomic<long long> hits;        // of which found the page in the pool
+  std::atomic<long long> diskreads;   // Number of pages read from disk (including allocs)
+  std::atomic<long long> diskwrites;  // Number of pages written back to disk
+  std::atomic<long long> fgwrites;    // of which written by a readPage/allocPage that needed the frame
+  std::atomic<long long> bgwrites;    // of which written ahead of time by the background writer
+  std::atomic<long long> evictclean;  // Pages evicted that were clean
+  std::atomic<long long> evictdirty;  // Pages evicted that had to be written first
+  std::atomic<long long> prefetchreads;  // Number of pages read from disk ahead of a scan
+  std::atomic<long long> prefetchhits;   // Prefetched pages later asked for by readPage
+  std::atomic<long long> prefetchunused; // Prefetched pages evicted before anyone asked
+  std::atomic<long long> skipped;     // Data pages scans left unread, see countSkipped
+  std::atomic<long long> packedpages; // Pages of compressed files read or written
+  std::atomic<long long> packedbytes; // the bytes they took on disk, see countPacked
+  Histogram readTime;     // ns per readPage call timed that succeeded, hit or miss
+  Histogram sweepLength;  // frames the policy looked at per frame allocated
+  Histogram decompressTime;  // ns per compressed page decompressed
+
+  // page bytes moved per byte on disk, 0 if no bytes were
+  const double compressionRatio() const;
 
   void clear()
     {
-      accesses = diskreads = diskwrites = 0;
+      accesses = hits = diskreads = diskwrites = 0;
+      fgwrites = bgwrites = 0;
+      evictclean = evictdirty = 0;
+      prefetchreads = prefetchhits = prefetchunused = 0;
+      skipped = 0;
+      packedpages = packedbytes = 0;
+      readTime.clear();
+      sweepLength.clear();
+      decompressTime.clear();
     }
       
   BufStats()
@@ -97,36 +337,174 @@ struct BufStats
 };
 
 
+// a pending read-ahead request: the numPages pages that follow pageNo
+// on its nextPage chain, or the pages listed in pageNos if any are
+struct PrefetchReq
+{
+  File* file;
+  int   pageNo;
+  int   numPages;
+  std::vector<int> pageNos;   // in ascending order
+};
+
+// called when a readPageAsync is over, with the page pinned if status
+// is OK and NULL otherwise
+typedef std::function<void(const Status status, Page* page)> PageDone;
+
+// size of the huge pages a pool may be backed by
+const size_t HUGEPAGESIZE = 2 << 20;
+
+// number of eviction candidates allocBuf asks the policy for at a time
+const int VICTIMBATCH = 8;
+
+// most read-ahead requests that may wait at once; later ones are dropped
+const unsigned MAXPREFETCHREQS = 64;
+
+// milliseconds the background writer sleeps between rounds, unless a
+// foreground write wakes it up early
+const int WRITERINTERVAL = 10;
+
+
+// The buffer manager may be used by several threads at once.  Hits
+// take only a hash partition latch; misses additionally latch the
+// frame being filled, and no latch but the victim frame's own is held
+// while a dirty victim is written back.
 class BufMgr 
 {
 private:
-  unsigned int 	 clockHand;
   int   	 numBufs;    	// Number of pages in buffer pool
+  BufPolicy*     policy;        // picks the frames to evict
   BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
   BufStats	 bufStats;	// buffer pool statistics
+  size_t	 poolBytes;	// size of the mapping bufPool is in
+  bool		 poolHuge;	// mapped with explicit huge pages
 
-  const Status allocBuf(int & frame);   // allocate a free frame.  
+  // allocate a free frame.  The frame is returned latched, pinned once
+  // and not in the hash table
+  const Status allocBuf(int & frame);
   const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
-  {
-	clockHand = (clockHand + 1) % numBufs;
-  }
+
+  // try to take frame i for allocBuf; PAGEPINNED if it is in use
+  const Status claimBuf(const int i);
+
+  // every file with pages in the pool and its frames, so that flushing
+  // a file costs time in proportion to its pages, not to the pool
+  std::mutex     fileLatch;     // protects fileFrames and the frame links
+  std::unordered_map<const File*, FileFrames> fileFrames;
+
+  void linkFrame(const int frame);     // frame now holds a page of its file
+  void unlinkFrame(const int frame);   // frame is about to lose its page
+  void markDirty(const int frame);     // put frame on its file's dirty list
+  void markClean(const int frame);     // take it off again if still clean
+  void unlinkDirty(FileFrames & ff, const int frame);
+
+  // (pageNo, frame) of the file's resident or dirty frames in pageNo order
+  void fileFramesOf(const File* file, const bool dirtyOnly,
+                    std::vector<std::pair<int, int> > & frames);
+
+  // common code of readPage and the prefetcher
+  const Status fetchPage(File* file, const int PageNo, Page*& page,
+                         const bool prefetch);
+
+  // read-ahead is done by one thread, started on the first request
+  std::thread             prefetcher;
+  std::mutex              prefetchLatch;  // protects the fields below
+  std::condition_variable prefetchCond;
+  std::deque<PrefetchReq> prefetchQueue;
+  const File*             prefetchFile;   // file the prefetcher is working on
+  bool                    prefetchStop;
+
+  void prefetchLoop();                    // body of the prefetch thread
+  const Status queuePrefetch(PrefetchReq & req);
+  void followChain(const PrefetchReq & req);
+  void readList(const PrefetchReq & req);
+
+  // read up to numPages pages from pageNo on that are not in the pool
+  // with one readPages call, leaving them unpinned; stops at the first
+  // page that is already there.  Returns the number of pages read
+  int readRun(File* file, const int pageNo, const int numPages);
+
+  // write the dirty ones among frames, which must be latched, in pageNo
+  // order and hold pages of one file, with a writePages call per run
+  // of consecutive pages; numWritten is the number of pages written
+  const Status writeRuns(const std::vector<int> & frames, int & numWritten);
+  void cancelPrefetch(const File* file);  // drop and wait out requests for file
+
+  // the optional background writer, see setBackgroundWriter
+  std::thread             writer;
+  std::mutex              writerLatch;    // protects the fields below
+  std::condition_variable writerCond;
+  double                  cleanTarget;    // fraction of the pool to keep clean
+  bool                    writerStop;
+
+  void writerLoop();                      // body of the writer thread
+  void cleanPool(const double target);    // one round of the writer
+
+  // readPageAsync reads still in flight, which the destructor waits out
+  std::atomic<int>        asyncReads;
+  std::mutex              asyncLatch;
+  std::condition_variable asyncCond;      // asyncReads fell to 0
+  void asyncReadDone(const int frameNo, const Status status, const PageDone & done);
+
+  // write back the unpinned ones among frames, (pageNo, frame) pairs of
+  // file in pageNo order, stopping after maxFrames frames are clean.
+  // Frames that are latched are skipped unless wait is set.  Returns
+  // the number made clean; numWritten is the pages written
+  int cleanFrames(const File* file, const std::vector<std::pair<int, int> > & frames,
+                  const int maxFrames, int & numWritten, const bool wait = false);
 
 
 public:
   Page*	         bufPool;   // actual buffer pool
 
-  BufMgr(const int bufs);
+  // a pool of bufs frames.  The pool is page aligned, as direct I/O
+  // wants; with hugePages it is backed by huge pages if the system has
+  // any reserved, else advised to be made of transparent huge pages
+  BufMgr(const int bufs, const ReplPolicy replPolicy = CLOCK,
+         const bool hugePages = false);
   ~BufMgr();
 
   const Status readPage(File* file, const int PageNo, Page*& page);
+
+  // pin (file, PageNo) without waiting for the disk: a page in the pool
+  // is handed to done before readPageAsync returns, and one that is not
+  // is read through the file's I/O engine, done being called as the
+  // engine completes the read, see IOEngine.  A read another thread has
+  // in progress is waited for.  done is not called if the status
+  // returned is not OK
+  const Status readPageAsync(File* file, const int PageNo, const PageDone & done);
   const Status unPinPage(File* file, const int PageNo, const bool dirty);
   const Status allocPage(File* file, int& PageNo, Page*& page); 
                         // allocates a new, empty page 
   const Status flushFile(const File* file); // writing out all dirty pages of the file
   const Status disposePage(File* file, const int PageNo); // dispose of page in file
-  void  printSelf();
+
+  // write back the listed pages of file that are resident, dirty and
+  // unpinned, in page order; they stay in the pool.  Pages that are
+  // busy or fail to write are left dirty
+  const Status flushPages(const File* file, const int pageNos[], const int numPages);
+
+  // write back every dirty, unpinned page of file, waiting for pages
+  // that are being written already; they stay in the pool
+  const Status flushDirty(const File* file);
+
+  // asynchronously read the numPages pages that follow PageNo on its
+  // nextPage chain into the pool, leaving them unpinned
+  const Status prefetch(File* file, const int PageNo, const int numPages);
+
+  // asynchronously read the numPages pages pageNos[] of file into the
+  // pool, in page order, leaving them unpinned
+  const Status prefetchPages(File* file, const int pageNos[], const int numPages);
+
+  // run a background thread that writes dirty, unpinned pages back, a
+  // file at a time in page order, whenever more than (1 - cleanFraction)
+  // of the pool is dirty.  0 stops it; BADBUFPARM unless 0 <= cleanFraction <= 1
+  const Status setBackgroundWriter(const double cleanFraction);
+
+  // write the counters and histograms of getBufStats, then the hits,
+  // misses and I/O times of each file with pages in the pool, to os
+  void  printStats(ostream & os);
 
   const BufStats & getBufStats() const // get buffer pool usage
   {
@@ -136,6 +514,23 @@ public:
   {
 	bufStats.clear();
   }
+
+  // count numPages pages a scan did not read because the file's page
+  // directory or a zone map showed they held nothing it wanted
+  void countSkipped(const int numPages)
+  {
+	bufStats.skipped += numPages;
+  }
+
+  // count a page of a compressed file read or written as diskBytes
+  // bytes, and the ns it took to decompress if decompressNs >= 0
+  void countPacked(const int diskBytes, const long long decompressNs)
+  {
+	bufStats.packedpages++;
+	bufStats.packedbytes += diskBytes;
+	if (decompressNs >= 0)
+	  bufStats.decompressTime.add(decompressNs);
+  }
 };
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "error.h"
+
+// A byte-oriented LZ77 block compressor in the manner of LZ4, used for
+// the pages of compressed files (see DB::setCompression).  A block is
+// a run of sequences, each a token byte, literals and a match: the
+// token's high nibble is the number of literals and its low nibble the
+// match length less MINMATCH, a nibble of 15 being continued by bytes
+// that are added to it until one is not 255.  The literals follow,
+// then the match as a two byte little-endian distance back into the
+// output and the continuation of its length.  The last sequence has
+// literals only.  Matches are found through a hash table of the last
+// position each 4 byte prefix was seen at, so compressing is a single
+// pass and decompressing little more than memcpy.
+
+// shortest match worth encoding
+const int MINMATCH = 4;
+
+// largest block that may be compressed, so that every distance fits
+// two bytes
+const int MAXBLOCK = 1 << 16;
+
+// compress the n (at most MAXBLOCK) bytes at src into dst, which has
+// room for cap bytes; the compressed length, or 0 if it exceeds cap
+const int compressBlock(const char* src, const int n, char* dst, const int cap);
+
+// decompress the srcLen bytes at src into exactly dstLen bytes at dst;
+// BADPACKED if src is not a block that decompresses to dstLen bytes.
+// Nothing outside of src and dst is touched whatever src holds
+const Status decompressBlock(const char* src, const int srcLen,
+                             char* dst, const int dstLen);
+
+#endif
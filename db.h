@@ -2,8 +2,15 @@
 #define DB_H
 
 #include <sys/types.h>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "error.h"
+#include "ioEngine.h"
 #include <string.h>
 using namespace std;
 
@@ -15,20 +22,180 @@ using namespace std;
 // forward class definition for db
 class DB;
 
-// class definition for open files
+// structure of DB (header) page
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list
+  int firstPage;                        // page # of first page in file
+  int numPages;                         // total # of pages in file
+  int packed;                           // 1 if the pages are stored compressed
+  int mapUnit;                          // first unit of the page map of a
+                                        // compressed file, -1 if none
+} DBPage;
+
+// most pages moved by one readPages or writePages system call
+const int MAXIOPAGES = 32;
+
+// fewest pages a file is grown by at a time
+const int EXTENDPAGES = MAXIOPAGES;
+
+// alignment of the buffers, offsets and lengths of direct I/O, enough
+// for devices with 512 byte and with 4K sectors.  Files are only opened
+// for direct I/O if a page is a multiple of it
+const int DIRECTALIGN = 4096;
+
+// A compressed file (see DB::setCompression) is kept in units of
+// PACKUNIT bytes.  Its header page takes the first units, stored as
+// is, and each other page a run of consecutive units anywhere in the
+// file, found through the page map.  A page is written to a run of its
+// own and then the map is pointed at it, so readers never see a page
+// half written.  The map is kept in memory while the file is open and
+// written to units of its own when it is closed.
+const int PACKUNIT = 128;
+
+// where a page of a compressed file is: length bytes from unit on.  A
+// length of 0 is a page of zeros, which takes no space, and a length
+// of sizeof(Page) a page that did not compress and is stored as is
+struct PageExtent
+{
+  int unit;
+  int length;
+};
+
+// A distribution of non-negative values over power of two buckets:
+// bucket 0 counts the zeros and bucket b > 0 the values in
+// [2^(b-1), 2^b), the last bucket also everything larger.  Adding a
+// value is two relaxed atomic increments, so any thread may add to a
+// histogram at any time; readers see a consistent enough picture.
+const int HISTBUCKETS = 48;
+
+struct Histogram
+{
+  std::atomic<long long> buckets[HISTBUCKETS];
+  std::atomic<long long> sum;   // of the values added
+
+  void add(const long long v)
+    {
+      int b = v <= 0 ? 0 : 64 - __builtin_clzll((unsigned long long)v);
+      if (b >= HISTBUCKETS) b = HISTBUCKETS - 1;
+      buckets[b].fetch_add(1, std::memory_order_relaxed);
+      sum.fetch_add(v, std::memory_order_relaxed);
+    }
+
+  const long long count() const;        // values added
+  const double mean() const;
+  // upper bound of the bucket that holds the fraction p of the values,
+  // 0 <= p <= 1; 0 if the histogram is empty
+  const long long percentile(const double p) const;
+  // one line: count, mean, median, 99th percentile and the largest bucket
+  void print(ostream & os) const;
+  void clear();
+
+  Histogram()
+    {
+      clear();
+    }
+};
+
+// a steady clock reading in nanoseconds, for timing with Histogram
+inline long long nanoTime()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Reading the clock can take tens of nanoseconds, about what a buffer
+// pool hit costs, so the latency histograms time only one call in
+// TIMESAMPLE.  Each call site counts its calls in a thread_local of
+// its own, which sampled bumps; it is true for the calls to time.
+const unsigned TIMESAMPLE = 64;
+
+inline bool sampled(unsigned & calls)
+{
+  return calls++ % TIMESAMPLE == 0;
+}
+
+// what the buffer manager sees of one file: hits and misses of its
+// readPage calls, and the time taken by each page read and write
+// system call, in nanoseconds
+struct FileStats
+{
+  std::atomic<long long> hits;     // readPage calls found the page in the pool
+  std::atomic<long long> misses;   // readPage calls that read it from disk
+  Histogram readTime;              // per readPage or readPages call timed
+  Histogram writeTime;             // per writePage or writePages call timed
+
+  void clear()
+    {
+      hits = misses = 0;
+      readTime.clear();
+      writeTime.clear();
+    }
+
+  FileStats()
+    {
+      clear();
+    }
+};
+
+// class definition for open files.  Page reads and writes and page
+// allocation may be called from several threads at once; reads and
+// writes use positional I/O and so do not serialize on the file.  The
+// header page is kept in memory while the file is open and written
+// back when it is closed.
 class File {
   friend class DB;
   friend class OpenFileHashTbl;
+  friend class BufMgr;
 
  public:
 
   Status allocatePage(int& pageNo);     // allocate a new page
+  // extend the file by numPages consecutive pages, the first of which
+  // is firstPageNo; the free list is not used
+  Status allocatePages(const int numPages, int& firstPageNo);
   const Status disposePage(const int pageNo);       // release space for a page
   const Status readPage(const int pageNo,
 		  Page* pagePtr) const;       // read page from file
   const Status writePage(const int pageNo,
 		   const Page* pagePtr);      // write page to file
+
+  // read or write the numPages (at most MAXIOPAGES) consecutive pages
+  // starting at pageNo in one system call; pages[i] is page pageNo+i
+  const Status readPages(const int pageNo, const int numPages,
+		   Page* const pages[]) const;
+  const Status writePages(const int pageNo, const int numPages,
+		   const Page* const pages[]);
+
+  // start reading or writing the same runs of pages on getIOEngine;
+  // done is called on an engine thread once the I/O is over.  The
+  // pages must stay put and the file open until then
+  const Status readPagesAsync(const int pageNo, const int numPages,
+		   Page* const pages[], const IODone & done) const;
+  const Status writePagesAsync(const int pageNo, const int numPages,
+		   const Page* const pages[], const IODone & done);
   const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  // returns the number of pages allocated, header page included.  The
+  // unix file may be longer, as extend grows it ahead, but pages from
+  // numPages on are refused by readPage and readPages
+  const Status getNumPages(int& numPages) const;
+
+  // map the pages the file has on disk read-only, advised for sequential
+  // access; pages[i] is page i and numPages the number mapped.  Pages
+  // still dirty in the buffer pool are seen as last written.  Release
+  // the mapping with unmapPages
+  const Status mapPages(const Page*& pages, int& numPages) const;
+  static void unmapPages(const Page* pages, const int numPages);
+
+  // true if reads and writes bypass the OS page cache, see DB::setDirectIO
+  bool isDirect() const { return direct; }
+
+  // true if the pages are stored compressed, see DB::setCompression
+  bool isCompressed() const { return packed; }
+
+  // counters kept since the file was opened or clearStats was called
+  const FileStats & getStats() const { return stats; }
+  void clearStats() { stats.clear(); }
 
   bool operator == (const File & other) const
     {
@@ -40,16 +207,35 @@ class File {
   File(const string &fname);                   // initialize
   ~File();                  // deallocate file object
 
-  static const Status create(const string &fileName);
+  static const Status create(const string &fileName, const bool packed);
   static const Status destroy(const string &fileName);
 
-  const Status open();
+  const Status open(const bool wantDirect);   // direct I/O if possible
   const Status close();
 
   const Status intread(const int pageNo,
 		 Page* pagePtr) const;        // internal file read
   const Status intwrite(const int pageNo,
 		  const Page* pagePtr);       // internal file write
+  const Status intreadv(const int pageNo, const int numPages,
+		  Page* const pages[]) const;       // internal multi-page read
+  const Status intwritev(const int pageNo, const int numPages,
+		  const Page* const pages[]);       // internal multi-page write
+  const Status intsubmit(const bool write, const int pageNo, const int numPages,
+		  const Page* const pages[], const IODone & done) const; // internal async I/O
+  const Status extend(const int numPages);    // grow the file to numPages
+  const Status writeHeader();                 // write hdr back if dirty
+  // true if the pages from pageNo on have all been allocated
+  const bool allocated(const int pageNo, const int numPages) const;
+
+  // the intread and intwrite of compressed files, for pages but 0
+  const Status packedRead(const int pageNo, Page* pagePtr) const;
+  const Status packedWrite(const int pageNo, const Page* pagePtr);
+  // take a run of n units, or give one back; mapLatch must be held
+  const int allocUnits(const int n);
+  void freeUnits(int unit, int n);
+  const Status readMap();                     // load pageMap at open
+  const Status writeMap();                    // and write it at close
 
 #ifdef DEBUGFREE
   void listFree();                      // list free pages
@@ -58,46 +244,67 @@ class File {
   string fileName;                    // The name of the file
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  bool direct;                        // opened with O_DIRECT
+  DBPage hdr;                         // the header page, while open
+  bool hdrDirty;                      // true if hdr has not been written
+  int diskPages;                      // size of the unix file in pages
+  mutable mutex hdrLatch;             // protects hdr and hdrDirty
+  bool packed;                        // hdr.packed, read without the latch
+  vector<PageExtent> pageMap;         // where each page of a compressed file is
+  vector<vector<int> > freeRuns;      // first units of the free runs of n units, by n
+  int endUnit;                        // units up to the end of the unix file
+  int mapUnits;                       // units the map on disk takes
+  bool mapDirty;                      // true if pageMap has not been written
+  mutable mutex mapLatch;             // protects pageMap to mapDirty; taken after hdrLatch
+  mutable FileStats stats;            // see getStats
 };
 
 class BufMgr;
 extern BufMgr* bufMgr;
 
-// declarations for hash table of open files
+// declarations for hash table of open files.  A bucket is keyed on the
+// name its File object holds, so it keeps no copy of its own.
 struct fileHashBucket
 {
-	string	fname;    // name of the file
         File*   file;    // pointer to file object
-	fileHashBucket* next;	 // next node in the hash table
+	fileHashBucket* next;	 // next node in the hash table, or on the free list
 	
 };
 
-// hash table to keep track of open files
+// buckets are allocated this many at a time and recycled
+const int FILEBUCKETCHUNK = 32;
+
+// hash table to keep track of open files.  Lookups take the name by
+// reference and neither copy nor allocate, and neither do inserts
+// while there are buckets on the free list.
 class OpenFileHashTbl
 {
 private:
     int HTSIZE;
     fileHashBucket**  ht; // actual hash table
-    int	 hash(string fileName);  // returns value between 0 and HTSIZE-1
+    fileHashBucket*   freeList; // buckets not in use
+    vector<fileHashBucket*> chunks; // all buckets, FILEBUCKETCHUNK at a time
+    int	 hash(const string & fileName) const;  // returns value between 0 and HTSIZE-1
 
 public:
     OpenFileHashTbl();
     ~OpenFileHashTbl(); // destructor
 	
     // returns OK if no error occured, HASHTBLERROR if an error occurred
-    Status insert(const string fileName, File* file);
+    Status insert(const string & fileName, File* file);
 
     // see if fileName is already in hash table.  If so a pointer to the file
     // object is returned.
     // returns OK if found. else returns HASHNOTFOUND
-    Status find(const string fileName, File*& file);
+    Status find(const string & fileName, File*& file) const;
 
     // returns OK if fileName was found.  Else return HASHTBLERROR
-    Status erase(const string fileName);
+    Status erase(const string & fileName);
 };
 
 
 
+// DB methods may be called from several threads at once.
 class DB {
  public:
   DB();                                 // initialize open file table
@@ -109,17 +316,25 @@ class DB {
   const Status openFile(const string & fileName, File* & file);  // open a file
   const Status closeFile(File* file);         // close a file
 
+  // open files from now on with O_DIRECT, where the file system allows
+  // it and a page is a multiple of DIRECTALIGN, so that the buffer pool
+  // is the only cache of their pages.  Files already open are left as
+  // they are; File::isDirect tells which ones got it
+  void setDirectIO(const bool on);
+
+  // create files from now on with their pages compressed, which trades
+  // the time to compress and decompress them for less disk space and
+  // fewer bytes read.  Meant for cold files; the setting is kept with
+  // the file, so later opens need not know about it.  Compressed files
+  // are never opened for direct I/O
+  void setCompression(const bool on);
+
  private:
   OpenFileHashTbl   openFiles;    // list of open files
+  mutex             latch;        // protects openFiles and open counts
+  bool              directIO;     // see setDirectIO
+  bool              compression;  // see setCompression
 };
 
 
-// structure of DB (header) page
-
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
-
 #endif
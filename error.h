@@ -17,16 +17,17 @@ enum Status {
 // File and DB errors
 
        BADFILEPTR, BADFILE, FILETABFULL, FILEOPEN, FILENOTOPEN,
-       UNIXERR, BADPAGEPTR, BADPAGENO, FILEEXISTS,
+       UNIXERR, BADPAGEPTR, BADPAGENO, FILEEXISTS, BADPACKED,
 
 // BufMgr and HashTable errors
 
        HASHTBLERROR, HASHNOTFOUND, BUFFEREXCEEDED, PAGENOTPINNED,
-       BADBUFFER, PAGEPINNED,
+       BADBUFFER, PAGEPINNED, BADBUFPARM,
 
 // Page errors
 	
        NOSPACE,  NORECORDS,  ENDOFPAGE, INVALIDSLOTNO, INVALIDRECLEN,
+       BADLAYOUT,
 
 // HeapFile errors
 
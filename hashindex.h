@@ -0,0 +1,103 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <vector>
+using namespace std;
+
+#include "index.h"
+
+// A hash index answers EQ lookups.  It uses linear hashing: buckets are split
+// one at a time, in order, whenever the index grows past MAXHASHLOAD,
+// so no bucket is ever rehashed more than once per doubling.  Keys are
+// stored as fixed size copies of the attribute; strings are cut at
+// their first NUL and zero padded, so two keys are equal exactly when
+// strncmp over the attribute length says so.
+
+// the header page of an index file
+struct HashHdrPage
+{
+  int		offset;		// byte offset of the attribute in the record
+  int		length;		// its length, which is the key size
+  int		type;		// its Datatype
+  int		level;		// 2^level buckets before this round of splits
+  int		next;		// next bucket to split in this round
+  int		numBuckets;	// 2^level + next
+  int		numEntries;	// entries in the index
+  int		firstMap;	// first page of the bucket map
+  int		lastMap;	// last page of the bucket map
+};
+
+// the bucket map lists the primary page of each bucket
+const unsigned MAPENTRIES = (PAGESIZE - 2 * sizeof(int)) / sizeof(int);
+
+struct HashMapPage
+{
+  int		nextMap;	// next map page, -1 for the last
+  int		numEntries;	// buckets listed on this page
+  int		pageNos[MAPENTRIES];
+};
+
+// a bucket is a primary page and a chain of overflow pages, each
+// holding numEntries (key, RID) pairs
+const unsigned HASHBUCKETFIXED = 2 * sizeof(int);
+
+struct HashBucketPage
+{
+  int		nextPage;	// next overflow page, -1 for the last
+  int		numEntries;	// entries on this page
+  char		data[PAGESIZE - HASHBUCKETFIXED];
+};
+
+// entries per bucket page, on average, past which a bucket is split
+const double MAXHASHLOAD = 0.75;
+
+// create an empty hash index file for the attribute
+const Status createHashIndex(const string & fileName, const int offset,
+                             const int length, const Datatype type);
+
+class HashIndex : public Index
+{
+public:
+
+  // open the index kept in fileName
+  HashIndex(const string & fileName, Status & status);
+
+  // end any scan and close the file
+  ~HashIndex();
+
+  const bool covers(const int offset, const int length, const Datatype type) const;
+  const bool handles(const Operator op) const;  // only EQ
+  const char* keyOf(const Record & rec) const;
+  const int getEntryCnt() const;
+  const Status insertEntry(const char* attr, const RID & rid);
+  const Status insertEntries(const char* const attrs[], const RID rids[], const int n);
+  const Status deleteEntry(const char* attr, const RID & rid);
+  const Status startScan(const char* attr, const Operator op);
+  const Status scanNext(RID & outRid);
+  const Status endScan();
+
+private:
+  File*		file;		// the index file
+  HashHdrPage*	hdr;		// its header page, pinned
+  int		hdrPageNo;
+  bool		hdrDirty;	// true if the header page has been updated
+  int		entrySize;	// key length + sizeof(RID)
+  int		perPage;	// entries that fit on a bucket page
+  vector<int>	buckets;	// primary page of each bucket, as last read
+
+  vector<char>	scanKey;	// key of the scan
+  int		scanPageNo;	// bucket page of the scan, -1 if none
+  Page*		scanPage;	// pinned while the scan is on it, or NULL
+  int		scanSlot;	// next entry of scanPage to look at
+
+  void makeKey(const char* attr, char* key) const;
+  const unsigned hashOf(const char* key) const;
+  const int bucketOf(const unsigned hash) const;
+  const Status bucketPage(const int bucket, int & pageNo); // primary page of bucket
+  const Status readMap();	// reread buckets from the bucket map
+  const Status appendMap(const int pageNo); // add a bucket, its primary page pageNo
+  const Status addToChain(const int pageNo, const char* entry);
+  const Status splitBucket();
+};
+
+#endif
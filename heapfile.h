@@ -2,7 +2,9 @@
 #define HEAPFILE_H
 
 #include <sys/types.h>
+#include <stddef.h>
 #include <functional>
+#include <unordered_map>
 #include <iostream>
 #include <vector>
 #include <string.h>
@@ -13,6 +15,8 @@ using namespace std;
 
 extern DB db;
 
+class Index;
+
 // define if debug output wanted
 //#define DEBUGREL
 
@@ -22,6 +26,57 @@ const unsigned MAXNAMESIZE = 50;
 enum Datatype { STRING, INTEGER, FLOAT };    // attribute data types
 enum Operator { LT, LTE, EQ, GTE, GT, NE };  // scan operators
 
+// The free space map gives the free space of every page of the file in
+// 4 bits, in units of FSMUNIT bytes (rounded down), entry p being for
+// page number p.  It fills a chain of map pages starting at
+// FileHdrPage::firstFsm, FSMENTRIES entries to a page, each of which
+// also keeps the largest entry of each group of FSMGROUP pages so that
+// a page with room is found without looking at every entry.  The
+// header page keeps the largest entry of each of the first FSMSUMMARY
+// map pages, so map pages without room are not read; later ones are
+// always looked at.  The fields before the summary take up to
+// FSMRESERVE bytes.
+const unsigned FSMRESERVE = 256;
+const unsigned FSMSUMMARY = PAGESIZE - FSMRESERVE;
+const unsigned FSMUNIT = PAGESIZE / 16;
+const unsigned FSMGROUP = 64;
+const unsigned FSMENTRIES = (PAGESIZE - sizeof(int)) * 2 * FSMGROUP / (FSMGROUP + 2)
+                            / FSMGROUP * FSMGROUP;
+
+struct FsmPage
+{
+  int		nextFsm;	// next map page, -1 for the last
+  unsigned char	fsm[FSMENTRIES / 2];	// free space of each page, 2 per byte
+  unsigned char	groupMax[FSMENTRIES / FSMGROUP]; // largest fsm entry per group
+};
+
+static_assert(sizeof(FsmPage) <= PAGESIZE, "FsmPage must fit on a page");
+
+// An attribute a zone map is kept for, see ZonePage
+struct ZoneCol
+{
+  int		offset;		// byte offset of the attribute in the record
+  int		length;		// its length
+  int		type;		// its Datatype
+  int		firstZone;	// pageNo of first zone map page
+};
+
+const unsigned MAXZONECOLS = 2;	// zone maps a file may have
+
+enum IndexKind { HASHINDEX, BTREEINDEX };	// index structures
+
+// An attribute an index is kept for.  The index is in a file of its
+// own, see indexFileName
+struct IndexCol
+{
+  int		offset;		// byte offset of the attribute in the record
+  int		length;		// its length
+  int		type;		// its Datatype
+  int		kind;		// its IndexKind
+};
+
+const unsigned MAXINDEXES = 4;	// indexes a file may have
+
 struct FileHdrPage
 {
   char		fileName[MAXNAMESIZE];   // name of file
@@ -29,8 +84,113 @@ struct FileHdrPage
   int		lastPage;	// pageNo of last data page in file
   int		pageCnt;	// number of pages
   int		recCnt;		// record count
+  int		firstDir;	// pageNo of first page directory page
+  int		lastDir;	// pageNo of last page directory page
+  int		numZoneCols;	// number of zone maps
+  ZoneCol	zoneCols[MAXZONECOLS]; // attributes they are kept for
+  int		numIndexes;	// number of indexes
+  IndexCol	indexCols[MAXINDEXES]; // attributes they are kept for
+  ColumnLayout	layout;		// of the data pages, numCols 0 for row pages
+  int		firstFsm;	// pageNo of first free space map page
+  int		numFsm;		// number of free space map pages
+  unsigned char	fsmMax[FSMSUMMARY];	// largest entry of each map page
+};
+
+static_assert(offsetof(FileHdrPage, fsmMax) <= FSMRESERVE, "FileHdrPage fields exceed FSMRESERVE");
+static_assert(sizeof(FileHdrPage) <= PAGESIZE, "FileHdrPage must fit on a page");
+
+// create heap file fileName with data pages of layout, columnar pages
+// unless layout.numCols is 0.  All records of a columnar file are of
+// the layout's length.  BADLAYOUT if columnCapacity rejects the layout
+const Status createHeapFile(const string fileName, const ColumnLayout & layout);
+
+// name of the file of the index of kind on the attribute at offset of
+// heap file fileName
+const string indexFileName(const string & fileName, const IndexKind kind,
+                           const int offset);
+
+// The page directory lists the data pages of a file in chain order,
+// with the number of records on each and its free space as of the last
+// insert or delete there.  It fills a chain of directory pages starting
+// at FileHdrPage::firstDir.  Entries are only ever appended, so a data
+// page keeps its entry number for as long as the file exists.
+struct DirEntry
+{
+  int		pageNo;		// data page
+  pageoff_t	recCnt;		// records on it
+  pageoff_t	freeSpace;	// bytes free on it
+};
+
+const unsigned DIRENTRIES = (PAGESIZE - 2 * sizeof(int)) / sizeof(DirEntry);
+
+struct DirPage
+{
+  int		nextDir;	// next directory page, -1 for the last
+  int		numEntries;	// entries in use
+  DirEntry	entries[DIRENTRIES];
+};
+
+static_assert(sizeof(DirPage) <= PAGESIZE, "DirPage must fit on a page");
+
+// A zone map keeps the smallest and largest value of one attribute on
+// each data page, so that a scan filtering on the attribute can leave
+// out pages that hold no match.  Its entries are in directory order,
+// on a chain of zone map pages.  Values are kept as keys of
+// ZONEKEYSIZE bytes: numbers as they are, strings cut off after
+// ZONEKEYSIZE characters.  Inserts and markDirty widen the range of a
+// page, deletes leave it alone, so it need not be tight.
+const unsigned ZONEKEYSIZE = 8;
+
+struct ZoneEntry
+{
+  int		numRecs;	// records the range covers, 0 if none yet
+  char		min[ZONEKEYSIZE]; // smallest key on the page
+  char		max[ZONEKEYSIZE]; // largest key on the page
+};
+
+const unsigned ZONEENTRIES = (PAGESIZE - sizeof(int)) / sizeof(ZoneEntry);
+
+struct ZonePage
+{
+  int		nextZone;	// next zone map page, -1 for the last
+  ZoneEntry	entries[ZONEENTRIES];
 };
 
+static_assert(sizeof(ZonePage) <= PAGESIZE, "ZonePage must fit on a page");
+
+
+// a column of a record to project out in a scan
+struct Projection
+{
+  int offset;   // byte offset of the column in the record
+  int length;   // length of the column
+};
+
+
+// predicate kernels, one instantiation per (Datatype, Operator) pair.
+// HeapFileScan::startScan binds them once so that evaluating a record
+// never branches on the scan parameters.
+typedef bool (*MatchFn)(const char* attr, const char* filter, const int length);
+typedef void (*BatchMatchFn)(const char* const attrs[], const int n,
+                             const char* filter, const int length,
+                             char match[]);
+
+// batched form for the n attributes at attrs, attrs + stride, ...,
+// such as a column of a columnar page
+typedef void (*ColumnMatchFn)(const char* attrs, const int stride, const int n,
+                              const char* filter, const int length,
+                              char match[]);
+
+// return the kernels for a (type, op) pair
+const MatchFn getMatchFn(const Datatype type, const Operator op);
+const BatchMatchFn getBatchMatchFn(const Datatype type, const Operator op);
+const ColumnMatchFn getColumnMatchFn(const Datatype type, const Operator op);
+
+
+// called by HeapFile::getRecords for record rids[i]; rec points into
+// its page, which stays pinned only for the call
+typedef std::function<void(const int i, const Record & rec)> RecordFn;
+
 
 // class definition of heapFile
 class HeapFile {
@@ -45,6 +205,71 @@ protected:
    bool  	curDirtyFlag;   // true if page has been updated
    RID   	curRec;         // rid of last record returned
 
+   // the page directory as of the last time it was read: entry k is
+   // for data page dirData[k] and kept on directory page
+   // dirPages[k / DIRENTRIES]
+   vector<int>	dirPages;
+   vector<int>	dirData;
+   unordered_map<int, int> dirPos; // data page number -> entry number,
+                                   // for a prefix of dirData
+   DirPage*	curDir;		// directory page pinned for updates, or NULL
+   int		curDirNo;	// its page number
+   bool		curDirDirty;	// true if it has been updated
+
+   ZonePage*	curZone[MAXZONECOLS]; // zone map page of each zone map
+                                      // pinned for updates, or NULL
+   int		curZoneNo[MAXZONECOLS]; // their page numbers
+   vector<int>	zonePages[MAXZONECOLS]; // pages of each zone map, in order
+
+   FsmPage*	curFsm;		// free space map page pinned for updates, or NULL
+   int		curFsmNo;	// its page number
+   bool		curFsmDirty;	// true if it has been updated
+   vector<int>	fsmPages;	// pages of the free space map, in order
+
+   // the indexes opened so far, indexes[i] being the one of
+   // headerPage->indexCols[i]
+   vector<Index*> indexes;
+
+   // record the record count and free space of data page pageNo
+   const Status dirUpdate(const int pageNo, const Page* page);
+   // add an entry for pageNo, the new last data page
+   const Status dirAppend(const int pageNo, const Page* page);
+   // make directory page dirNo curDir
+   const Status pinDir(const int dirNo);
+   // entry number of data page pageNo, rereading the directory if
+   // pageNo was added since; -1 if it is not in the directory
+   const int dirEntryOf(const int pageNo);
+   // widen the zone map ranges of data page pageNo to cover rec
+   const Status zoneAdd(const int pageNo, const Record & rec);
+   // make sure zone map c has a page for directory entry k
+   const Status zoneReserve(const int c, const int k);
+   // make page z of zone map c curZone[c]
+   const Status pinZone(const int c, const int z);
+   // reread the list of pages of zone map c
+   const Status readZonePages(const int c);
+   // record freeSpace as the free space map entry of page pageNo,
+   // adding map pages as far as pageNo if need be
+   const Status fsmSet(const int pageNo, const int freeSpace);
+   // a page the free space map says has room for a record of length
+   // bytes, or -1
+   const int fsmFind(const int length);
+   // make page f of the free space map curFsm
+   const Status pinFsm(const int f);
+   // reread the list of pages of the free space map
+   const Status readFsmPages();
+   // open the indexes of the file not in indexes yet
+   const Status openIndexes();
+   // add record rec at rid to, or remove it from, every index
+   const Status indexInsert(const Record & rec, const RID & rid);
+   const Status indexDelete(const Record & rec, const RID & rid);
+   // build an index of kind on the attribute and register it
+   const Status addIndex(const IndexKind kind, const int offset,
+                         const int length, const Datatype type);
+   // initialize new data page pageNo in the format of the file
+   void initPage(Page* page, const int pageNo) const;
+   // can a record of length bytes go into the file
+   const bool validRecLength(const int length) const;
+
 public:
 
   // initialize
@@ -56,8 +281,36 @@ public:
   // return number of records in file
   const int getRecCnt() const;
 
+  // return number of data pages in file
+  const int getPageCnt() const;
+
   // given a RID, read record from file, returning pointer and length
   const Status getRecord(const RID &rid, Record & rec);
+
+  // call fn for each of the n records rids[], pinning each page they
+  // are on once; the calls come in page order
+  const Status getRecords(const RID rids[], const int n, const RecordFn & fn);
+
+  // as above, copying the records into buf, and pointing outRecs[i] at
+  // the copy of record rids[i]
+  const Status getRecords(const RID rids[], const int n, Record outRecs[],
+                          vector<char> & buf);
+
+  // return the page directory, one entry per data page in chain order
+  const Status getDirectory(vector<DirEntry> & entries);
+
+  // keep a zone map for the attribute at offset, built from the records
+  // in the file now; returns FILEHDRFULL if MAXZONECOLS are kept already
+  const Status addZoneMap(const int offset, const int length, const Datatype type);
+
+  // keep a hash index on the attribute at offset, built from the records
+  // in the file now; returns INDEXEXISTS if there is one on offset already
+  // and FILEHDRFULL if MAXINDEXES indexes are kept
+  const Status addHashIndex(const int offset, const int length, const Datatype type);
+
+  // keep a B+-tree index on the attribute at offset, bulk loaded from
+  // the records in the file now; returns as addHashIndex
+  const Status addBTreeIndex(const int offset, const int length, const Datatype type);
 };
 
 
@@ -76,28 +329,71 @@ public:
                            const char* filter, 
                            const Operator op);
 
+    // as above, and project the numCols columns cols[] out of each
+    // record for getColumns and scanNextColumns
+    const Status startScan(const int offset, 
+                           const int length,  
+                           const Datatype type, 
+                           const char* filter, 
+                           const Operator op,
+                           const Projection cols[],
+                           const int numCols);
+
     const Status endScan(); // terminate the scan
     const Status markScan(); // save current position of scan
     const Status resetScan(); // reset scan to last marked location
 
-    // return RID of next record that satisfies the scan 
+    // return RID of next record that satisfies the scan
     const Status scanNext(RID& outRid);
 
-    // read current record, returning pointer and length
+    // point colPtrs[c] at projected column c of the current record, on
+    // the pinned page; NULL if the record is too short to hold it
+    const Status getColumns(const char* colPtrs[]);
+
+    // copy the projected columns of up to maxRows of the next matching
+    // records into colBufs[c], column c of row r going to colBufs[c] +
+    // r * cols[c].length (zeros if the record is too short to hold
+    // it).  Unlike scanNextBatch rows may come from several pages.
+    // Returns FILEEOF (with numRows == 0) at the end of the file
+    const Status scanNextColumns(char* const colBufs[], const int maxRows,
+                                 int& numRows);
+
+    // return up to maxRids RIDs of the next records that satisfy the
+    // scan; all of them lie on one data page, which stays pinned.
+    // Returns FILEEOF (with numRids == 0) at the end of the file
+    const Status scanNextBatch(RID outRids[], const int maxRids, int& numRids);
+
+    // read current record, returning pointer and length.  The record
+    // of a columnar file is a copy kept by the scan, which markDirty
+    // writes back
     const Status getRecord(Record & rec);
 
+    // read a record returned by the last scanNextBatch call without
+    // moving the scan; returns BADRID if it is not on the pinned page
+    const Status getRecord(const RID & rid, Record & rec);
+
     // delete current record 
     const Status deleteRecord();
 
-    // marks current page of scan dirty
+    // marks current page of scan dirty.  Indexed attributes of the
+    // current record must not have been changed
     const Status markDirty();
 
+    // keep up to numPages pages read ahead of the scan (0 disables)
+    const Status setReadAhead(const int numPages);
+
 private:
     int   offset;            // byte offset of filter attribute
     int   length;            // length of filter attribute
     Datatype type;           // datatype of filter attribute
     const char* filter;      // comparison value of filter
     Operator op;             // comparison operator of filter
+    MatchFn matchFn;         // kernel bound to (type, op) by startScan
+    BatchMatchFn batchMatchFn; // batched form of matchFn
+    ColumnMatchFn columnMatchFn; // and its form for columnar pages
+    vector<Projection> cols; // columns projected by getColumns
+    int   readAhead;         // # of pages to prefetch ahead of the scan
+    int   readAheadDue;      // pages left until the next prefetch request
 
      // The following variables are used to preserve the state
     // of the scan when the method markScan() is invoked.
@@ -105,8 +401,181 @@ private:
     // scan to be rolled back to the following
     int   markedPageNo;	// page number of pinned page
     RID   markedRec;         // rid of last record returned
+    int   markedPos;         // and its place in scanPages
+
+    // a pass the filter of which a zone map applies to visits the
+    // pages of scanPages, otherwise it follows the nextPage chain
+    int   zoneCol;           // zone map of the current pass, -1 if none
+    vector<int> scanPages;   // pages the zone map did not rule out
+    int   scanPos;           // index of curPageNo in scanPages
+
+    // copy of the record of a columnar page getRecord returned last,
+    // and its RID (NULLRID if none)
+    vector<char> row;
+    RID   rowRid;
 
     const bool matchRec(const Record & rec) const;
+    // does record rid of page satisfy the filter
+    const bool matchRid(Page* page, const RID & rid) const;
+    void readAheadFrom();    // prefetch past curPageNo when due
+    const int firstScanPage(); // start a pass, returning its first page or -1
+    const int nextScanPage();  // page after curPageNo in the pass, or -1
+
+protected:
+    // evaluate the predicate on every record of page that follows
+    // after (NULLRID for the whole page); returns # of matches.  Only
+    // reads the scan parameters, so threads may call it concurrently
+    const int matchPage(Page* page, const RID & after, RID matches[]) const;
+
+    // list the data pages of the file, in directory order, leaving out
+    // those that are empty or that a zone map shows to hold no match
+    const Status pagesToScan(vector<int> & pageNos);
+
+    // zone map kept for the filter attribute, -1 if none
+    const int zoneMapFor() const;
+};
+
+
+// A scan that evaluates its predicate on several threads at once.  The
+// pages to scan come from the page directory, so the workers take
+// entries off it, and read and match their pages, independently of
+// each other; pages the directory lists as empty, or a zone map rules
+// out, are not read at all.
+// The usual scanNext interface keeps working and is serial.
+class ParallelHeapFileScan : public HeapFileScan
+{
+public:
+
+    ParallelHeapFileScan(const string & name, Status & status);
+
+    // run the scan on numWorkers threads (the caller being one of them)
+    // and return the RIDs of all matching records, in the order scanNext
+    // would return them
+    const Status scanAll(const int numWorkers, vector<RID> & outRids);
+
+private:
+    // state shared by the workers of one scanAll call
+    struct Work {
+        vector<int> pageNos;        // the pages to scan
+        std::atomic<int> nextEntry; // next entry of pageNos to hand out
+        std::mutex latch;           // protects status
+        Status status;              // first error a worker ran into
+    };
+
+    // where the matches of one page a worker took are
+    struct Matches {
+        int seq;            // entry of the page in pageNos
+        int start;          // its first RID in the worker's rids
+        int count;          // and the number of RIDs
+    };
+
+    void worker(Work & work, vector<Matches> & pages, vector<RID> & rids) const;
+};
+
+
+// A read-only scan that walks the nextPage chain over a memory mapping
+// of the file instead of reading pages through the buffer pool.  Each
+// pass first writes back the file's dirty pages, so it sees every
+// change except those on pages other scans hold pinned.  Records it
+// returns point into the mapping, which is read-only, and stay valid
+// until the next pass starts or the scan is deleted; those of a
+// columnar file are copies, see Page::getRecord.
+class MappedHeapFileScan
+{
+public:
+
+    MappedHeapFileScan(const string & name, Status & status);
+
+    // end scan and unmap the file
+    ~MappedHeapFileScan();
+
+    const Status startScan(const int offset, 
+                           const int length,  
+                           const Datatype type, 
+                           const char* filter, 
+                           const Operator op);
+
+    const Status endScan(); // terminate the scan
+    const Status markScan(); // save current position of scan
+    const Status resetScan(); // reset scan to last marked location
+
+    // return RID of next record that satisfies the scan
+    const Status scanNext(RID& outRid);
+
+    // read current record, returning pointer and length
+    const Status getRecord(Record & rec);
+
+private:
+    File*       filePtr;       // underlying DB File object
+    const Page* pages;         // the mapping, pages[i] is page i
+    int         numPages;      // # of pages mapped
+    const Page* curPage;       // page of the scan, NULL if none
+    int         curPageNo;     // its page number, -1 after the last page
+    RID         curRec;        // rid of last record returned
+    int         markedPageNo;  // state saved by markScan
+    RID         markedRec;
+
+    int   offset;            // byte offset of filter attribute
+    int   length;            // length of filter attribute
+    const char* filter;      // comparison value of filter
+    MatchFn matchFn;         // kernel bound by startScan, NULL if no filter
+
+    // write back dirty pages, remap the file if it grew and return the
+    // first data page, for the start of a pass
+    const Status beginPass(int & firstPageNo);
+
+    const bool matchRec(const Record & rec) const;
+};
+
+
+// IndexScan takes up to INDEXBATCH RIDs from the index at a time and
+// returns them sorted by page, so that getRecord reads each page once
+// per batch
+const unsigned INDEXBATCH = 4096;
+
+// A scan for the records whose attribute satisfies a predicate, which
+// looks the value up in an index on the attribute and so only reads the
+// pages of matching records.  EQ lookups use a hash index if there is
+// one, range lookups need a B+-tree index.
+class IndexScan : public HeapFile
+{
+public:
+
+    IndexScan(const string & name, Status & status);
+
+    // end scan
+    ~IndexScan();
+
+    // start a scan for the records whose attribute (offset, length,
+    // type) equals filter; NOINDEX if the file has no index on it
+    const Status startScan(const int offset,
+                           const int length,
+                           const Datatype type,
+                           const char* filter);
+
+    // as above, for the records whose attribute a satisfies "a op
+    // filter"; NOINDEX if no index of the file handles op on it
+    const Status startScan(const int offset,
+                           const int length,
+                           const Datatype type,
+                           const char* filter,
+                           const Operator op);
+
+    const Status endScan(); // terminate the scan
+
+    // return RID of next matching record; FILEEOF after the last one
+    const Status scanNext(RID& outRid);
+
+    // read current record, returning pointer and length
+    const Status getRecord(Record & rec);
+
+private:
+    Index* index;            // index of the scan, NULL if none
+    vector<RID> batch;       // RIDs taken from it, sorted by page
+    unsigned batchPos;       // next RID of batch to return
+    bool indexDone;          // true once the index has no more RIDs
+
+    const Status nextBatch(); // refill batch from the index
 };
 
 
@@ -121,6 +590,11 @@ public:
 
     // insert record into file, returning its RID
     const Status insertRecord(const Record & rec, RID& outRid); 
+
+    // append the n records recs[] to the end of the file, returning
+    // their RIDs in outRids[]; pages are filled in order, and each one
+    // is written out as soon as it is full
+    const Status bulkInsert(const Record recs[], const int n, RID outRids[]);
 };
 
 #endif
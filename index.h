@@ -0,0 +1,49 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "heapfile.h"
+
+// An index maps the values of one attribute of the records of a heap
+// file to their RIDs.  Each is kept in a DB file of its own, see
+// indexFileName, and read through the buffer pool.  HeapFile keeps the
+// indexes of a file up to date and IndexScan looks values up in them.
+
+class Index
+{
+public:
+  virtual ~Index() {}
+
+  // does the index cover the attribute (offset, length, type)
+  virtual const bool covers(const int offset, const int length, const Datatype type) const = 0;
+
+  // can scans look up values with op
+  virtual const bool handles(const Operator op) const = 0;
+
+  // the attribute of rec it indexes, NULL if rec is too short to hold it
+  virtual const char* keyOf(const Record & rec) const = 0;
+
+  // number of entries in the index
+  virtual const int getEntryCnt() const = 0;
+
+  // add an entry for value attr of the attribute in record rid
+  virtual const Status insertEntry(const char* attr, const RID & rid) = 0;
+
+  // add entries for the n values attrs[i] in records rids[i]
+  virtual const Status insertEntries(const char* const attrs[], const RID rids[],
+                                     const int n) = 0;
+
+  // remove the entry for attr and rid; RECNOTFOUND if there is none
+  virtual const Status deleteEntry(const char* attr, const RID & rid) = 0;
+
+  // start a scan for the entries whose key k satisfies "k op attr";
+  // BADSCANPARM if the index does not handle op
+  virtual const Status startScan(const char* attr, const Operator op) = 0;
+
+  // return the RID of the next matching entry; NOMORERECS at the end
+  virtual const Status scanNext(RID & outRid) = 0;
+
+  // end the scan, unpinning its page
+  virtual const Status endScan() = 0;
+};
+
+#endif
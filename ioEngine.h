@@ -0,0 +1,62 @@
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <functional>
+#include "error.h"
+
+// An I/O engine runs page reads and writes asynchronously, so that one
+// thread can keep many of them in flight.  On Linux kernels that have
+// it the engine is an io_uring; elsewhere, or if the ring cannot be set
+// up, a pool of threads doing preadv and pwritev stands in.  Requests
+// are completed in no particular order, each by calling its done
+// function on an engine thread or, with io_uring, in whichever submit
+// call finds it finished, possibly its own.  done should therefore be
+// short, must not wait for other asynchronous I/O, which may need the
+// same thread, and must not take locks the submitter may hold.
+
+// called when a request finishes: OK, or UNIXERR if the read or write
+// failed or moved fewer bytes than asked for
+typedef std::function<void(const Status status)> IODone;
+
+// most buffers one request may move
+const int MAXIOVECS = 32;
+
+// requests the engine of getIOEngine keeps in flight at once; submit
+// waits for one to finish when there are this many
+const int IODEPTH = 64;
+
+// threads of the thread pool engine
+const int IOTHREADS = 4;
+
+class IOEngine
+{
+public:
+  // the io_uring engine if the kernel lets us set one up, otherwise
+  // the thread pool, each allowing depth requests in flight
+  static IOEngine* create(const int depth);
+  static IOEngine* createUring(const int depth);  // NULL if there is no io_uring
+  static IOEngine* createThreadPool(const int depth, const int threads);
+
+  // waits for the requests in flight to finish
+  virtual ~IOEngine() {}
+
+  // Read (or write) the iovcnt buffers of iov from (to) byte offset of
+  // the file descriptor fd, calling done once it is over.  iov is
+  // copied, the buffers it points to must stay put until done is
+  // called.  BADBUFPARM if iovcnt is out of range; done is then not
+  // called
+  virtual const Status submit(const int fd, const bool write, const off_t offset,
+                              const struct iovec iov[], const int iovcnt,
+                              const IODone & done) = 0;
+
+  // "io_uring" or "threads"
+  virtual const char* name() const = 0;
+};
+
+// the engine File's asynchronous reads and writes go to, made on first
+// use and shut down at exit
+IOEngine* getIOEngine();
+
+#endif
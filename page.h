@@ -17,44 +17,128 @@ struct Record
   int length;
 };
 
+// page size in bytes, chosen at build time (make PAGESIZE=8192); any
+// power of two from 1 KB to 64 KB.  Files written with one page size
+// cannot be read with another.
+#ifndef MINIREL_PAGESIZE
+#define MINIREL_PAGESIZE 1024
+#endif
+
+#if MINIREL_PAGESIZE < 1024 || MINIREL_PAGESIZE > 65536 || \
+    (MINIREL_PAGESIZE & (MINIREL_PAGESIZE - 1)) != 0
+#error "MINIREL_PAGESIZE must be a power of two from 1024 to 65536"
+#endif
+
+const unsigned PAGESIZE = MINIREL_PAGESIZE;
+
+// type of byte offsets and counts within a page; short covers pages
+// of up to 32 KB
+#if MINIREL_PAGESIZE <= 32768
+typedef short pageoff_t;
+#else
+typedef int pageoff_t;
+#endif
+
 // slot structure
 struct slot_t {
-        short	offset;  
-        short	length;  // equals -1 if slot is not in use
+        pageoff_t	offset;  
+        pageoff_t	length;  // equals -1 if slot is not in use
 };
 
-const unsigned PAGESIZE = 1024;
-const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(short)+2*sizeof(int);
+const unsigned MAXSLOTS = (PAGESIZE/(sizeof(slot_t)+1) + 31) / 32 * 32;
+// most slots a page may have, a multiple of the occupancy bitmap word size
+const unsigned SLOTMAPWORDS = MAXSLOTS / 32;
+const unsigned DPFIXED= sizeof(slot_t)+5*sizeof(pageoff_t)+2*sizeof(int)
+                        +SLOTMAPWORDS*sizeof(unsigned int);
 const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
 // size of the data area of a page
+const unsigned MAXRECSPERPAGE = MAXSLOTS;
+// upper bound on the number of live records on a page
+
+// page formats
+const pageoff_t ROWPAGE = 0;	// records stored whole, found through slots
+const pageoff_t COLPAGE = 1;	// records split into columns, see below
+
+// A columnar page keeps records of one fixed length split into columns,
+// each in a minipage of its own: the value of column c for slot s lies
+// at a fixed place in minipage c, so a filter on an attribute within
+// one column reads a contiguous array instead of every record.  Column
+// c holds bytes [o, o + colLen[c]) of each record, o being the sum of
+// the lengths of the columns before it.  The slots of a columnar page
+// are numbered 0 to its capacity - 1 up front, and the occupancy bitmap
+// says which of them hold a record.
+const unsigned MAXCOLUMNS = 8;
+
+struct ColumnLayout
+{
+  int		numCols;		// columns, 0 for row pages
+  int		colLen[MAXCOLUMNS];	// their lengths, in record order
+};
+
+// length of the records of layout, or -1 if it has no columns, more
+// than MAXCOLUMNS or one of length < 1
+const int columnRecLength(const ColumnLayout & layout);
+
+// records a columnar page of layout holds, 0 if the layout is bad or
+// a record does not fit on a page
+const int columnCapacity(const ColumnLayout & layout);
 
 // Class definition for a minirel data page.   
-// The design assumes that records are kept compacted when
-// deletions are performed. Notice, however, that the slot
-// array cannot be compacted.  Notice, this class does not keep
+// Deletions leave holes in the data area that are only compacted
+// when an insertion needs the space (or compact() is called).
+// Notice, however, that the slot array cannot be compacted.  Notice, this class does not keep
 // the records align, relying instead on upper levels to take
-// care of non-aligned attributes
+// care of non-aligned attributes.
+// Empty slots in the middle of the slot array are chained into a free
+// list through their offset fields, and a bitmap in the header records
+// which slots hold a record, so neither inserts nor scans have to step
+// over the holes one slot at a time.
+// A page initialized by initColumnar instead holds fixed length records
+// in columns, described above ColumnLayout; the methods below work on
+// both, except where they say otherwise.
 
 class Page {
 private:
     char 	data[PAGESIZE - DPFIXED]; 
     slot_t 	slot[1]; // first element of slot array - grows backwards!
-    short	slotCnt; // number of slots in use;
-    short	freePtr; // offset of first free byte in data[]
-    short	freeSpace; // number of bytes free in data[]
-    short	dummy;	// for alignment purposes
+    pageoff_t	slotCnt; // number of slots in use;
+    pageoff_t	freePtr; // offset of first free byte in data[]
+    pageoff_t	freeSpace; // number of bytes free in data[]
+    pageoff_t	freeSlot; // first slot on the free slot list, -1 if none
+    pageoff_t	format;   // ROWPAGE or COLPAGE
     int		nextPage; // forwards pointer
     int		curPage;  // page number of current pointer
+    unsigned int slotMap[SLOTMAPWORDS]; // bit i set if slot i holds a record
+
+    // the slot array, indexed by negative format slot numbers.  Going
+    // through this pointer rather than slot[] keeps the optimizer from
+    // assuming that slot[] has no elements but slot[0]
+    slot_t* slots()
+      { return (slot_t*) ((char*) this + PAGESIZE - DPFIXED); }
+    const slot_t* slots() const
+      { return (const slot_t*) ((const char*) this + PAGESIZE - DPFIXED); }
+
+    const bool inUse(const int slotNo) const; // does slotNo hold a record
+    const int nextInUse(const int slotNo) const; // first used slot >= slotNo
+    void rebuildFreeSlots(); // rethread the free list through empty slots
 
 public:
     void init(const int pageNo); // initialize a new page
+    // initialize a new columnar page; layout must be one columnCapacity
+    // accepts
+    void initColumnar(const int pageNo, const ColumnLayout & layout);
+    const bool isColumnar() const { return format == COLPAGE; }
     void dumpPage() const;       // dump contents of a page
 
     const Status getNextPage(int& pageNo) const; // returns value of nextPage
     const Status setNextPage(const int pageNo); // sets value of nextPage to pageNo
-    const short getFreeSpace() const; // returns amount of free space
+    const pageoff_t getFreeSpace() const; // returns amount of free space
+    const int getRecCnt() const; // returns number of records on the page
+    const pageoff_t getFragmentedSpace() const; // free space held in holes
+    void compact(); // close up the holes left by deleted records
 
-    // inserts a new record (rec) into the page, returns RID of record 
+    // inserts a new record (rec) into the page, returns RID of record.
+    // INVALIDRECLEN if the page is columnar and rec is not of its length
     const Status insertRecord(const Record & rec, RID& rid);
 
     // delete the record with the specified rid
@@ -68,8 +152,22 @@ public:
     // returns ENDOFPAGE if no more records exist on the page
     const Status nextRecord (const RID & curRid, RID& nextRid) const;
 
-    // returns reference to record with RID rid
+    // returns reference to record with RID rid.  The record of a
+    // columnar page is put together in a buffer of the calling thread,
+    // which its next getRecord of a columnar page overwrites
     const Status getRecord(const RID & rid, Record & rec);
+
+    // overwrite record rid with rec, which must be of the same length
+    const Status updateRecord(const RID & rid, const Record & rec);
+
+    // where a columnar page keeps the attribute at (offset, length) of
+    // its records: that of slot s is at the returned pointer + s *
+    // stride, for slots 0 to numSlots - 1, whether or not they hold a
+    // record.  NULL for row pages and attributes not within one column
+    const char* getColumn(const int offset, const int length,
+                          int & stride, int & numSlots) const;
 };
 
+static_assert(sizeof(Page) == PAGESIZE, "Page must fill exactly one page");
+
 #endif